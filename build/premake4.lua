@@ -10,7 +10,7 @@ configuration "release"
 configuration "*"
 
 buildoptions { "-std=c++11", "-Wall", "-pedantic" }
-links { "sfml-window", "sfml-system", "sfml-graphics" }
+links { "sfml-window", "sfml-system", "sfml-graphics", "pthread" }
 
 project "oldschoolfx"
 
@@ -1,4 +1,11 @@
 
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+#include <vector>
+
 #include "demohelper.hpp"
 
 // ---------------------------------------------------------------------------------------
@@ -7,7 +14,7 @@
 
 struct ccparams
 {
-	sf::Uint8* data;
+	const sf::Uint8* data;
 	int x0, y0, x1, y1;
 };
 
@@ -25,13 +32,40 @@ static inline sf::Uint8 computeCC(int, int, int x, int y, const ccparams& p)
 	return demo::sample(p.data, u, v);
 }
 
+// computeCC over the screen expanded through pal, with row terms hoisted
+DEMO_KERNEL_IMPL void renderCCImpl(sf::Uint32* __restrict dst, int W, int H, const ccparams& p, const sf::Uint32* __restrict pal)
+{
+	int idx[demo::SampleChunk];
+	for (int y = 0; y < H; ++y)
+	{
+		const int dy0 = (y - p.y0) * (y - p.y0);
+		const int dy1 = (y - p.y1) * (y - p.y1);
+		for (int x0 = 0; x0 < W; x0 += demo::SampleChunk)
+		{
+			const int n = std::min(demo::SampleChunk, W - x0);
+			for (int i = 0; i < n; ++i)
+			{
+				const int dx0 = x0 + i - p.x0;
+				const int dx1 = x0 + i - p.x1;
+				idx[i] = demo::sampleIndex((dx0 * dx0 + dy0) / 512, (dx1 * dx1 + dy1) / 512);
+			}
+			sf::Uint32* __restrict d = dst + y * W + x0;
+			for (int i = 0; i < n; ++i)
+				d[i] = pal[p.data[idx[i]]];
+		}
+	}
+}
+
+DEMO_KERNEL(renderCC, renderCCImpl,
+	(sf::Uint32* dst, int W, int H, const ccparams& p, const sf::Uint32* pal), (dst, W, H, p, pal))
+
 // ---------------------------------------------------------------------------------------
 // rotozoom
 // ---------------------------------------------------------------------------------------
 
 struct rzparams
 {
-	sf::Uint8* data;
+	const sf::Uint8* data;
 	int cx, cy; // center
 	int dx, dy; // direction
 };
@@ -50,6 +84,33 @@ inline sf::Uint8 computeRotozoom(int w, int h, int x, int y, const rzparams& p)
 	return demo::sample(p.data, nx, ny);
 }
 
+// computeRotozoom over the screen expanded through pal, with row terms hoisted
+DEMO_KERNEL_IMPL void renderRotozoomImpl(sf::Uint32* __restrict dst, int W, int H, const rzparams& p, const sf::Uint32* __restrict pal)
+{
+	int idx[demo::SampleChunk];
+	for (int y = 0; y < H; ++y)
+	{
+		const int ry = y - H / 2;
+		const int ax = p.cx - ry * p.dy;
+		const int ay = p.cy + ry * p.dx;
+		for (int x0 = 0; x0 < W; x0 += demo::SampleChunk)
+		{
+			const int n = std::min(demo::SampleChunk, W - x0);
+			for (int i = 0; i < n; ++i)
+			{
+				const int rx = x0 + i - W / 2;
+				idx[i] = demo::sampleIndex((ax + rx * p.dx) / 256, (ay + rx * p.dy) / 256);
+			}
+			sf::Uint32* __restrict d = dst + y * W + x0;
+			for (int i = 0; i < n; ++i)
+				d[i] = pal[p.data[idx[i]]];
+		}
+	}
+}
+
+DEMO_KERNEL(renderRotozoom, renderRotozoomImpl,
+	(sf::Uint32* dst, int W, int H, const rzparams& p, const sf::Uint32* pal), (dst, W, H, p, pal))
+
 // ---------------------------------------------------------------------------------------
 // plasma
 // ---------------------------------------------------------------------------------------
@@ -61,7 +122,7 @@ inline sf::Uint8 samplePlasma(int x, int y)
 
 struct plasmaparams
 {
-	sf::Uint8* data;
+	const sf::Uint8* data;
 	int frame;
 };
 
@@ -73,10 +134,68 @@ static inline sf::Uint8 computePlasma(int, int, int x, int y, const plasmaparams
 	return p0 + p1 + p2;
 }
 
+// computePlasma over the screen expanded through pal, with row terms hoisted
+DEMO_KERNEL_IMPL void renderPlasmaImpl(sf::Uint32* __restrict dst, int W, int H, const plasmaparams& p, const sf::Uint32* __restrict pal)
+{
+	int idx0[demo::SampleChunk];
+	int idx1[demo::SampleChunk];
+	int idx2[demo::SampleChunk];
+	const int t1 = (20 * p.frame) / 16;
+	const int t2 = (27 * p.frame) / 16;
+	for (int y = 0; y < H; ++y)
+	{
+		const int y0 = y / 2;
+		const int y1 = 3 * y / 2;
+		const int s1 = demo::fakesin<int>(y + t1, 256);
+		for (int x0 = 0; x0 < W; x0 += demo::SampleChunk)
+		{
+			const int n = std::min(demo::SampleChunk, W - x0);
+			for (int i = 0; i < n; ++i)
+			{
+				const int x = x0 + i;
+				idx0[i] = demo::sampleIndex(x + y0, y1);
+				idx1[i] = demo::sampleIndex(x + s1, y);
+				idx2[i] = demo::sampleIndex(5 * x / 4, y + demo::fakesin<int>(x + t2, 256));
+			}
+			sf::Uint32* __restrict d = dst + y * W + x0;
+			for (int i = 0; i < n; ++i)
+				d[i] = pal[sf::Uint8(p.data[idx0[i]] + p.data[idx1[i]] + p.data[idx2[i]])];
+		}
+	}
+}
+
+DEMO_KERNEL(renderPlasma, renderPlasmaImpl,
+	(sf::Uint32* dst, int W, int H, const plasmaparams& p, const sf::Uint32* pal), (dst, W, H, p, pal))
+
 // ---------------------------------------------------------------------------------------
 // fire
 // ---------------------------------------------------------------------------------------
-inline void setFire(int w, int h, sf::Uint16* d, int frame)
+DEMO_KERNEL_IMPL sf::Uint16 fireCell(int c, int bl, int b, int br)
+{
+	const int v = (2 * c + 1 * bl + 3 * b + 2 * br) / 8;
+	return sf::Uint16(v > 255 ? v - 256 : v);
+}
+
+DEMO_KERNEL_IMPL void fireBlurImpl(sf::Uint16* d, int w, int h)
+{
+	// two loops per frame for quicker fire
+	for (int j = 0; j < 2; ++j)
+	{
+		for (int y = 0; y < h - 1; ++y)
+		{
+			// blur upward in place, first pixel reads the end of its own row
+			sf::Uint16* __restrict row = d + y * w;
+			const sf::Uint16* __restrict below = row + w;
+			row[0] = fireCell(row[0], row[w - 1], below[0], below[1]);
+			for (int x = 1; x < w; ++x)
+				row[x] = fireCell(row[x], below[x - 1], below[x], below[x + 1]);
+		}
+	}
+}
+
+DEMO_KERNEL(fireBlur, fireBlurImpl, (sf::Uint16* d, int w, int h), (d, w, h))
+
+inline void setFire(int w, int h, sf::Uint16* d, int frame, demo::rng& rnd)
 {
 	// use 16bpp buffer to increase quality
 
@@ -85,24 +204,14 @@ inline void setFire(int w, int h, sf::Uint16* d, int frame)
 	{
 		for (int j = 0; j < w;)
 		{
-			sf::Uint8 r = 192 + 63 * (rand() % 2);
+			sf::Uint8 r = 192 + 63 * rnd(2);
 			// 10 pixels bloc
 			for (int i = 0; i < 10; ++i, ++j)
-				d[(h - 1) * w + j] = (r << 8) + rand() % 256;
+				d[(h - 1) * w + j] = (r << 8) + rnd(256);
 		}
 	}
 
-	// two loops per frame for quicker fire
-	for (int j = 0; j < 2; ++j)
-	{
-		for (int i = 0; i < (h - 1) * w; ++i)
-		{
-			// blur upward in place
-			d[i] = (2 * d[i] + 1 * d[i + w - 1] + 3 * d[i + w] + 2 * d[i + w + 1]) / 8;
-			if (d[i] > 255)
-				d[i] -= 256;
-		}
-	}
+	fireBlur(d, w, h);
 }
 
 // ---------------------------------------------------------------------------------------
@@ -125,16 +234,16 @@ inline sf::Uint8 getAtClamp(const sf::Uint8* const rnd, int w, int h, int x, int
 	return rnd[ny * w + nx];
 }
 
-sf::Uint8 computeNoise(int x, int y, int w, int h)
+sf::Uint8 computeNoise(int x, int y, int w, int h, demo::rng& rnd)
 {
-	return (rand() % 1000 > 750 ? 224 : 0) + rand() % 32;
+	return (rnd(1000) > 750 ? 224 : 0) + rnd(32);
 }
 
-void fillNoise(sf::Uint8* rndNoise, int w, int h)
+void fillNoise(sf::Uint8* rndNoise, int w, int h, demo::rng& rnd)
 {
 	for (int y = 0, offset = 0; y < h; ++y)
 		for (int x = 0; x < w; ++x)
-			rndNoise[offset++] = computeNoise(x, y, w, h);
+			rndNoise[offset++] = computeNoise(x, y, w, h, rnd);
 }
 
 inline sf::Uint8 sampleNoise(int x, int y, sf::Uint8* const rnd, int rw, int rh, int steps)
@@ -178,7 +287,7 @@ inline sf::Uint8 sampleNoise(int x, int y, sf::Uint8* const rnd, int rw, int rh,
 // bump
 // ---------------------------------------------------------------------------------------
 
-void bump(sf::Uint8* dst, const sf::Uint8* src, int W, int H, int lposx, int lposy)
+DEMO_KERNEL_IMPL void bumpImpl(sf::Uint8* dst, const sf::Uint8* src, int W, int H, int lposx, int lposy)
 {
 	const int coeff = 16;
 	const int div = 256;
@@ -198,6 +307,9 @@ void bump(sf::Uint8* dst, const sf::Uint8* src, int W, int H, int lposx, int lpo
 	}
 }
 
+DEMO_KERNEL(bump, bumpImpl,
+	(sf::Uint8* dst, const sf::Uint8* src, int W, int H, int lposx, int lposy), (dst, src, W, H, lposx, lposy))
+
 // ---------------------------------------------------------------------------------------
 // tunnel
 // ---------------------------------------------------------------------------------------
@@ -230,42 +342,75 @@ void waterInit(tWaterHeight* dst, int W, int H)
 		dst[offset] = MediumHeight ;
 }
 
-void waterMove(tWaterHeight* dst, const tWaterHeight* src, int W, int H)
+// t, m, b: rows above, at and below, xl and xr: left and right columns
+DEMO_KERNEL_IMPL tWaterHeight waterCell(int prev, const tWaterHeight* t, const tWaterHeight* m, const tWaterHeight* b, int xl, int x, int xr)
 {
-	for (int y = 0, offset = 0; y < H; ++y)
+	const int vt = int(t[x]);
+	const int vb = int(b[x]);
+	const int vl = int(m[xl]);
+	const int vr = int(m[xr]);
+
+	const int vtl = int(t[xl]);
+	const int vtr = int(t[xr]);
+	const int vbl = int(b[xl]);
+	const int vbr = int(b[xr]);
+
+	// computed as offsets from MediumHeight so divisions truncate toward rest
+	// and small ripples die out completely instead of lingering at -1
+	const int w = 3 * 4 + 2 * 4;
+	const int s = (3 * (vt + vb + vl + vr) + 2 * (vtl + vtr + vbl + vbr) - w * MediumHeight) / w;
+
+	const int nv = 2 * s - (prev - MediumHeight);
+	const int div = 32;
+	return MediumHeight + ((div - 1) * nv) / div;
+}
+
+// stores v at d[x], ors into changed when it differs from the previous d[x] and into differs when it differs from m[x]
+DEMO_KERNEL_IMPL void waterStore(tWaterHeight* __restrict d, const tWaterHeight* __restrict m, int x, tWaterHeight v, tWaterHeight& changed, tWaterHeight& differs)
+{
+	changed |= v ^ d[x];
+	differs |= v ^ m[x];
+	d[x] = v;
+}
+
+// updates [x0, x1) x [y0, y1), diffs[0] becomes non zero when dst changed and diffs[1] when dst and src differ there
+DEMO_KERNEL_IMPL void waterMoveImpl(tWaterHeight* dst, const tWaterHeight* src, int W, int H, int x0, int y0, int x1, int y1, int* diffs)
+{
+	tWaterHeight changed = 0;
+	tWaterHeight differs = 0;
+	for (int y = y0; y < y1; ++y)
 	{
-		for (int x = 0; x < W; ++x, ++offset)
+		// borders reuse the center row or column, inner columns have no branch
+		const tWaterHeight* __restrict m = src + y * W;
+		const tWaterHeight* __restrict t = y == 0     ? m : m - W;
+		const tWaterHeight* __restrict b = y == H - 1 ? m : m + W;
+		tWaterHeight* __restrict d = dst + y * W;
+		int x = x0;
+		if (x == 0)
 		{
-			const int dx0 = x == 0     ? 0 : -1;
-			const int dx1 = x == W - 1 ? 0 :  1;
-			const int dy0 = y == 0     ? 0 : -W;
-			const int dy1 = y == H - 1 ? 0 :  W;
-
-			const int vt = int(src[offset + dy0]);
-			const int vb = int(src[offset + dy1]);
-			const int vl = int(src[offset + dx0]);
-			const int vr = int(src[offset + dx1]);
-
-			const int vtl = int(src[offset + dy0 + dx0]);
-			const int vtr = int(src[offset + dy0 + dx1]);
-			const int vbl = int(src[offset + dy1 + dx0]);
-			const int vbr = int(src[offset + dy1 + dx1]);
-
-			const int s = (3 * (vt + vb + vl + vr) + 2 * (vtl + vtr + vbl + vbr)) / (3 * 4 + 2 * 4);
-
-			const int nv = 2 * s - dst[offset];
-			const int div = 32;
-			dst[offset] = (MediumHeight  + ((div - 1) * nv)) / div;
+			waterStore(d, m, 0, waterCell(d[0], t, m, b, 0, 0, 1), changed, differs);
+			++x;
 		}
+		const int xe = x1 == W ? W - 1 : x1;
+		for (; x < xe; ++x)
+			waterStore(d, m, x, waterCell(d[x], t, m, b, x - 1, x, x + 1), changed, differs);
+		if (x1 == W)
+			waterStore(d, m, W - 1, waterCell(d[W - 1], t, m, b, W - 2, W - 1, W - 1), changed, differs);
 	}
+	diffs[0] = changed;
+	diffs[1] = differs;
 }
 
+DEMO_KERNEL(waterMove, waterMoveImpl,
+	(tWaterHeight* dst, const tWaterHeight* src, int W, int H, int x0, int y0, int x1, int y1, int* diffs), (dst, src, W, H, x0, y0, x1, y1, diffs))
+
+// updates [x0, x1) x [y0, y1)
 template <typename T>
-void waterDistort(T* dst, const T* src, const tWaterHeight* hm, int W, int H, int mul, int div)
+void waterDistort(T* dst, const T* src, const tWaterHeight* hm, int W, int H, int mul, int div, int x0, int y0, int x1, int y1)
 {
-	for (int y = 0, offset = 0; y < H; ++y)
+	for (int y = y0; y < y1; ++y)
 	{
-		for (int x = 0; x < W; ++x, ++offset)
+		for (int x = x0, offset = y * W + x0; x < x1; ++x, ++offset)
 		{
 			int nx = x + mul * (int(hm[offset + 1]) - int(hm[offset])) / div;
 			int ny = y + mul * (int(hm[offset + W]) - int(hm[offset])) / div;
@@ -274,6 +419,131 @@ void waterDistort(T* dst, const T* src, const tWaterHeight* hm, int W, int H, in
 	}
 }
 
+// tiles of both heightmaps. A tile is changed when the last write to its heightmap
+// altered it. waterMove on a tile whose own and surrounding source heights are all
+// unchanged gives back the same heights so it is skipped, and waterDistort on a
+// tile whose heights match the ones used at the previous frame is skipped too.
+// Tiles at rest stay unchanged, so the cost follows the disturbed area.
+class watertiles
+{
+public:
+	// wide tiles keep the vectorized kernels on long rows
+	static constexpr int TILEW = 64;
+	static constexpr int TILEH = 16;
+
+	watertiles(int W, int H)
+	: _w(W)
+	, _h(H)
+	, _tw((W + TILEW - 1) / TILEW)
+	, _th((H + TILEH - 1) / TILEH)
+	{
+		reset();
+	}
+
+	// both heightmaps were just filled with MediumHeight
+	void reset()
+	{
+		for (int i = 0; i < 2; ++i)
+			_changed[i].assign(_tw * _th, 1);
+		_same.assign(_tw * _th, 0);
+		_plotted.assign(_tw * _th, 0);
+		_full = true;
+	}
+
+	// heightmap hm was changed around (cx, cy)
+	void plot(int hm, int cx, int cy, int r)
+	{
+		const int tx0 = std::max(0, (cx - r) / TILEW);
+		const int ty0 = std::max(0, (cy - r) / TILEH);
+		const int tx1 = std::min(_tw - 1, (cx + r) / TILEW);
+		const int ty1 = std::min(_th - 1, (cy + r) / TILEH);
+		for (int ty = ty0; ty <= ty1; ++ty)
+		{
+			for (int tx = tx0; tx <= tx1; ++tx)
+			{
+				const int t = ty * _tw + tx;
+				_changed[hm][t] = 1;
+				_same[t] = 0;
+				_plotted[t] = 1;
+			}
+		}
+	}
+
+	// waterMove from heightmap 1 - hm into heightmap hm
+	void move(tWaterHeight* dst, const tWaterHeight* src, int hm, demo::workerpool& pool)
+	{
+		std::vector<char>& cd = _changed[hm];
+		const std::vector<char>& cs = _changed[1 - hm];
+		_active.clear();
+		for (int ty = 0, t = 0; ty < _th; ++ty)
+		{
+			for (int tx = 0; tx < _tw; ++tx, ++t)
+			{
+				bool skip = !cd[t];
+				for (int y = std::max(0, ty - 1); skip && y <= std::min(_th - 1, ty + 1); ++y)
+					for (int x = std::max(0, tx - 1); skip && x <= std::min(_tw - 1, tx + 1); ++x)
+						skip = !cs[y * _tw + x];
+				if (!skip)
+					_active.push_back(t);
+			}
+		}
+		pool.run(int(_active.size()), [&] (int j) {
+			const int t = _active[j];
+			const demo::rect r = tileRect(t);
+			int diffs[2];
+			waterMove(dst, src, _w, _h, r.x0, r.y0, r.x1, r.y1, diffs);
+			cd[t] = diffs[0] != 0;
+			_same[t] = diffs[1] == 0;
+		});
+	}
+
+	// calls f(rect) on tiles whose distortion through the heightmap last moved into can change, returns their region
+	template <typename F>
+	demo::rect distort(const F& f, demo::workerpool& pool)
+	{
+		// the previous frame read the other heightmap before it was plotted. Distortion also
+		// reads heights at right, on the next row for the last column, and below, where the
+		// extra last line is always MediumHeight.
+		auto kept = [&] (int tx, int ty) { return ty >= _th || (_same[ty * _tw + tx] && !_plotted[ty * _tw + tx]); };
+		demo::rect updated = { 0, 0, 0, 0 };
+		_active.clear();
+		for (int ty = 0, t = 0; ty < _th; ++ty)
+		{
+			for (int tx = 0; tx < _tw; ++tx, ++t)
+			{
+				const bool right = tx + 1 < _tw ? kept(tx + 1, ty) : kept(0, ty) && kept(0, ty + 1);
+				if (!_full && kept(tx, ty) && right && kept(tx, ty + 1))
+					continue;
+				_active.push_back(t);
+				updated = updated.merge(tileRect(t));
+			}
+		}
+		pool.run(int(_active.size()), [&] (int j) { f(tileRect(_active[j])); });
+		_plotted.assign(_tw * _th, 0);
+		_full = false;
+		return updated;
+	}
+
+private:
+	demo::rect tileRect(int t) const
+	{
+		const int x = (t % _tw) * TILEW;
+		const int y = (t / _tw) * TILEH;
+		return { x, y, std::min(_w, x + TILEW), std::min(_h, y + TILEH) };
+	}
+
+	int _w, _h;
+	int _tw, _th;
+	// per tile, changed by the last write to heightmap 0 or 1
+	std::vector<char> _changed[2];
+	// both heightmaps hold the same heights
+	std::vector<char> _same;
+	// plotted since the last distortion
+	std::vector<char> _plotted;
+	std::vector<int> _active;
+	bool _full = true;
+};
+
 // ---------------------------------------------------------------------------------------
 // bars
 // ---------------------------------------------------------------------------------------
@@ -334,45 +604,59 @@ void drawBars(sf::Uint8* dst, int W, int H, int frame)
 }
 
 // ---------------------------------------------------------------------------------------
-// main
+// fx state
 // ---------------------------------------------------------------------------------------
 
-int main(int, char**)
+const int ScrWidth = 320;
+const int ScrHeight = 200;
+typedef demo::demowin<ScrWidth, ScrHeight> tWin320x200;
+typedef tWin320x200::tBackBuffer tBackBuffer;
+
+typedef demo::buffer<sf::Uint8, ScrWidth, ScrHeight, demo::frameb<sf::Uint8, ScrWidth, ScrHeight>> tScreen8;
+typedef demo::buffer<sf::Uint16, ScrWidth, ScrHeight, demo::frameb<sf::Uint16, ScrWidth, ScrHeight>> tScreen16;
+typedef std::array<sf::Uint32, 256> tPalette;
+
+// read only images, shared by all instances and baked when first needed
+struct fxassets
 {
-	// open window
-	const int ScrWidth = 320;
-	const int ScrHeight = 200;
-	typedef demo::demowin<ScrWidth, ScrHeight> tWin320x200;
-	tWin320x200 win;
+	static constexpr int NoiseWidth = 40;
+	static constexpr int NoiseHeight = 25;
+	static constexpr int NoiseSteps = 6;
+
+	// an empty cachePrefix always bakes, see demo::asset
+	fxassets(sf::Uint32 seed, const char* cachePrefix)
+	: bidon("noise", demo::assetKey({ seed, NoiseWidth, NoiseHeight, NoiseSteps }), [seed] (sf::Uint8* d) {
+		demo::rng rnd(seed);
+		sf::Uint8 rndNoise[NoiseWidth * NoiseHeight] = { 0 };
+		fillNoise(rndNoise, NoiseWidth, NoiseHeight, rnd);
+		demo::fillBuffer<sf::Uint8, ScrWidth, ScrHeight>(d, [&] (int x, int y) { return sampleNoise(x, y, rndNoise, NoiseWidth, NoiseHeight, NoiseSteps); });
+	}, cachePrefix)
+	, pipo("plasma", demo::assetKey({}), [] (sf::Uint8* d) { demo::fillBuffer<sf::Uint8, 256, 256>(d, samplePlasma); }, cachePrefix)
+	, mito("xor", demo::assetKey({}), [] (sf::Uint8* d) { demo::fillBuffer<sf::Uint8, 256, 256>(d, sampleRZ); }, cachePrefix)
+	{
+	}
 
-	// back buffers
-	auto fb16a = win.createBuffer<sf::Uint16>();
-	auto fb16b = win.createBuffer<sf::Uint16>();
-	auto fb8a = win.createBuffer<sf::Uint8>();
-	//auto fb8b = win.createBuffer<sf::Uint8>();
-	//auto fb8c = win.createBuffer<sf::Uint8>();
+	demo::asset<sf::Uint8, ScrWidth, ScrHeight> bidon;
+	demo::asset<sf::Uint8, 256, 256> pipo;
+	demo::asset<sf::Uint8, 256, 256> mito;
+};
 
-	// fx buffers
-	auto cc       = new demo::buffer<sf::Uint8, ScrWidth, ScrHeight, demo::procst<sf::Uint8, ScrWidth, ScrHeight, ccparams, computeCC>>();
-	auto rotozoom = new demo::buffer<sf::Uint8, ScrWidth, ScrHeight, demo::procst<sf::Uint8, ScrWidth, ScrHeight, rzparams, computeRotozoom>>();
-	auto plasma   = new demo::buffer<sf::Uint8, ScrWidth, ScrHeight, demo::procst<sf::Uint8, ScrWidth, ScrHeight, plasmaparams, computePlasma>>();
-
-	// images
-	const int NW = 40, NH = 25;
-	sf::Uint8 rndNoise[NW * NH] = { 0 };
-	fillNoise(rndNoise, NW, NH);
-	auto bidon = demo::makeBuffer<sf::Uint8, 320, 200>(sampleNoise, &rndNoise[0], NW, NH, 6);
-	auto pipo  = demo::makeBuffer<sf::Uint8, 256, 256>(samplePlasma);
-	auto mito  = demo::makeBuffer<sf::Uint8, 256, 256>(sampleRZ);
-
-	// palettes
-	const auto palGrey    = demo::makeRampPal<sf::Uint32, 256>( { 0xff000000, 0xffffffff } );
-	const auto palBump    = demo::makeRampPal<sf::Uint32, 256>( { 0xff0f0000, 0xff00007f, 0xff00007f, 0xff7fffff, 0xff7f7fff } );
-	const auto palCC      = demo::makeRampPal<sf::Uint32, 256>( { 0xff00ff00, 0xffff00ff } );
-	const auto palRZ      = demo::makeRampPal<sf::Uint32, 256>( { 0xff0000ff, 0xffffff00 } );
-	const auto palPlasma  = demo::makeRampPal<sf::Uint32, 256>( { 0xffff0000, 0xff0000ff, 0xff00ffff, 0xffff0000 } );
-	const auto palFire    = demo::makeRampPal<sf::Uint32, 256>( { 0xff000000, 0xff0000ff, 0xff00ffff, 0xffffffff, 0xffffffff } );
-	const auto palDistort = demo::makePal<sf::Uint32, 256>([] (int i) {
+struct fxpalettes
+{
+	tPalette grey, bump, cc, rz, plasma, fire, distort;
+};
+
+// variant rotates color channels of every palette
+fxpalettes makePalettes(int variant)
+{
+	fxpalettes r;
+	r.grey    = demo::makeRampPal<sf::Uint32, 256>( { 0xff000000, 0xffffffff } );
+	r.bump    = demo::makeRampPal<sf::Uint32, 256>( { 0xff0f0000, 0xff00007f, 0xff00007f, 0xff7fffff, 0xff7f7fff } );
+	r.cc      = demo::makeRampPal<sf::Uint32, 256>( { 0xff00ff00, 0xffff00ff } );
+	r.rz      = demo::makeRampPal<sf::Uint32, 256>( { 0xff0000ff, 0xffffff00 } );
+	r.plasma  = demo::makeRampPal<sf::Uint32, 256>( { 0xffff0000, 0xff0000ff, 0xff00ffff, 0xffff0000 } );
+	r.fire    = demo::makeRampPal<sf::Uint32, 256>( { 0xff000000, 0xff0000ff, 0xff00ffff, 0xffffffff, 0xffffffff } );
+	r.distort = demo::makePal<sf::Uint32, 256>([] (int i) {
 		int c = 16 + 2 * (i % 64);
 		switch (i / 64) {
 			case 0: return demo::abgr(255, c, c, 0);
@@ -382,123 +666,444 @@ int main(int, char**)
 		}
 		return 0u;
 	});
+	for (int i = 0; i < variant % 3; ++i) {
+		for (tPalette* p : { &r.grey, &r.bump, &r.cc, &r.rz, &r.plasma, &r.fire, &r.distort }) {
+			for (sf::Uint32& c : *p)
+				c = (c & 0xff000000) | ((c << 8) & 0x00ffff00) | ((c >> 16) & 0x000000ff);
+		}
+	}
+	return r;
+}
+
+// per instance buffers and parameters
+struct fxstate
+{
+	fxstate(const fxassets& a, const fxpalettes& p, sf::Uint32 s, int workers = 1)
+	: assets(a)
+	, pal(p)
+	, seed(s)
+	, rnd(s)
+	, pool(workers)
+	, water(ScrWidth, ScrHeight)
+	{
+	}
+	fxstate(const fxstate&) = delete;
+	fxstate& operator=(const fxstate&) = delete;
+	~fxstate()
+	{
+		delete fb16a;
+		delete fb16b;
+		delete fb8a;
+		delete cc;
+		delete rotozoom;
+		delete plasma;
+		delete cycleIdx;
+	}
+
+	const fxassets& assets;
+	fxpalettes pal;
+	sf::Uint32 seed;
+	demo::rng rnd;
+
+	// threads an FX may use inside one frame
+	demo::workerpool pool;
+
+	// back buffers
+	tScreen16* fb16a = new tScreen16();
+	tScreen16* fb16b = new tScreen16();
+	tScreen8* fb8a = new tScreen8();
+
+	// fx buffers
+	demo::buffer<sf::Uint8, ScrWidth, ScrHeight, demo::procst<sf::Uint8, ScrWidth, ScrHeight, ccparams, computeCC>>* cc
+		= new demo::buffer<sf::Uint8, ScrWidth, ScrHeight, demo::procst<sf::Uint8, ScrWidth, ScrHeight, ccparams, computeCC>>();
+	demo::buffer<sf::Uint8, ScrWidth, ScrHeight, demo::procst<sf::Uint8, ScrWidth, ScrHeight, rzparams, computeRotozoom>>* rotozoom
+		= new demo::buffer<sf::Uint8, ScrWidth, ScrHeight, demo::procst<sf::Uint8, ScrWidth, ScrHeight, rzparams, computeRotozoom>>();
+	demo::buffer<sf::Uint8, ScrWidth, ScrHeight, demo::procst<sf::Uint8, ScrWidth, ScrHeight, plasmaparams, computePlasma>>* plasma
+		= new demo::buffer<sf::Uint8, ScrWidth, ScrHeight, demo::procst<sf::Uint8, ScrWidth, ScrHeight, plasmaparams, computePlasma>>();
+
+	// palette cycling, indices are computed once
+	tScreen8* cycleIdx = new tScreen8();
+	demo::palcache<sf::Uint32, 256> cyclePal;
+
+	// highest fire row with visible color at last frame
+	int fireTop = 0;
+
+	// changed parts of fb16a and fb16b during water FX
+	watertiles water;
+};
 
-	typedef std::function<void(tWin320x200::tBackBuffer&, int)> tFxFunc;
+// ---------------------------------------------------------------------------------------
+// fx list
+// ---------------------------------------------------------------------------------------
 
-	// water
-	tFxFunc waterFunc = [&] (tWin320x200::tBackBuffer& bgFb, int frame) {
+struct waterfx
+{
+	static void prewarm(const fxassets& a) { a.bidon.prewarm(); }
+	void operator()(fxstate& s, tBackBuffer& bgFb, int frame) const
+	{
 		if (frame == 0) {
-			waterInit(fb16a->data(), ScrWidth, ScrHeight); 
-			waterInit(fb16b->data(), ScrWidth, ScrHeight); 
+			waterInit(s.fb16a->data(), ScrWidth, ScrHeight);
+			waterInit(s.fb16b->data(), ScrWidth, ScrHeight);
+			s.water.reset();
 		}
 		const float sc = 0.03f;
 		const bool b = (frame % 2 == 0);
-		auto b0 = b ? fb16a : fb16b;
-		auto b1 = b ? fb16b : fb16a;
-		waterPlot(
-			b1->data(),
-			ScrWidth,
-			ScrHeight,
-			ScrWidth * (0.5f * (1.0f + 0.8f * cosf(sc * frame))),
-			ScrHeight * (0.5f * (1.0f + 0.8f * sinf(1.2f * sc * frame))),
-			10
-		);
-		waterMove(b0->data(), b1->data(), ScrWidth, ScrHeight);
-		waterDistort(fb8a->data(), bidon->data(), b0->data(), ScrWidth, ScrHeight, 4, 16 * 256);
-		bgFb.transformOfs(*fb8a, [&] (sf::Uint8 l) { return palGrey[l]; });
-	};
+		auto b0 = b ? s.fb16a : s.fb16b;
+		auto b1 = b ? s.fb16b : s.fb16a;
+		const int hm0 = b ? 0 : 1;
+		const int cx = ScrWidth * (0.5f * (1.0f + 0.8f * cosf(sc * frame)));
+		const int cy = ScrHeight * (0.5f * (1.0f + 0.8f * sinf(1.2f * sc * frame)));
+		waterPlot(b1->data(), ScrWidth, ScrHeight, cx, cy, 10);
+		s.water.plot(1 - hm0, cx, cy, 10);
+		s.water.move(b0->data(), b1->data(), hm0, s.pool);
+		const demo::rect r = s.water.distort([&] (const demo::rect& t) {
+			waterDistort(s.fb8a->data(), s.assets.bidon.data(), b0->data(), ScrWidth, ScrHeight, 4, 16 * 256, t.x0, t.y0, t.x1, t.y1);
+		}, s.pool);
+		s.fb8a->touch(r);
+		// whole rows keep the texture upload contiguous
+		demo::expandPal8(bgFb.data() + r.y0 * ScrWidth, s.fb8a->data() + r.y0 * ScrWidth, s.pal.grey.data(), (r.y1 - r.y0) * ScrWidth);
+		bgFb.touch({ 0, r.y0, ScrWidth, r.y1 });
+	}
+};
 
-	// bump
-	tFxFunc bumpFunc = [&] (tWin320x200::tBackBuffer& bgFb, int frame) {
+struct bumpfx
+{
+	static void prewarm(const fxassets& a) { a.bidon.prewarm(); }
+	void operator()(fxstate& s, tBackBuffer& bgFb, int frame) const
+	{
 		const float sc = 0.03f;
 		bump(
-			fb8a->data(),
-			bidon->data(),
+			s.fb8a->data(),
+			s.assets.bidon.data(),
 			ScrWidth,
 			ScrHeight,
 			ScrWidth * (0.5f * (1.0f + 0.9f * cosf(sc * frame))),
 			ScrHeight * (0.5f * (1.0f + 0.9f * sinf(1.2f * sc * frame)))
 		);
-		bgFb.transformOfs(*fb8a, [&] (sf::Uint8 l) { return palBump[l]; });
-	};
+		s.fb8a->touch();
+		demo::expandPal8(bgFb.data(), s.fb8a->data(), s.pal.bump.data(), ScrWidth * ScrHeight);
+		bgFb.touch();
+	}
+};
 
-	// plasma
-	tFxFunc plasmaFunc = [&] (tWin320x200::tBackBuffer& bgFb, int frame) {
-		plasma->_params = {
-			pipo->data(),
+struct plasmafx
+{
+	static void prewarm(const fxassets& a) { a.pipo.prewarm(); }
+	void operator()(fxstate& s, tBackBuffer& bgFb, int frame) const
+	{
+		s.plasma->_params = {
+			s.assets.pipo.data(),
 			frame,
 		};
-		bgFb.transformXY(*plasma, [&] (sf::Uint8 l) { return palPlasma[l]; });
-	};
+		renderPlasma(bgFb.data(), ScrWidth, ScrHeight, s.plasma->_params, s.pal.plasma.data());
+		bgFb.touch();
+	}
+};
 
-	// rotozoom
-	tFxFunc rzFunc = [&] (tWin320x200::tBackBuffer& bgFb, int frame) {
+struct rzfx
+{
+	static void prewarm(const fxassets& a) { a.mito.prewarm(); }
+	void operator()(fxstate& s, tBackBuffer& bgFb, int frame) const
+	{
 		const float rzf = 0.5f * frame;           // time
 		const float a = 0.03f * rzf;              // angle
 		const float z = 1.2f + cosf(0.05f * rzf); // zoom
 		const float r = 256.0f * 500.0f;                   // move radius
-		rotozoom->_params = {
-			mito->data(),
+		s.rotozoom->_params = {
+			s.assets.mito.data(),
 			int(128.0f + r * cosf(0.03f * rzf)) , int(128.0f + r * cosf(0.04f * rzf)), // center
 			int(256.0f * z * cosf(a)), int(256.0f * z * sinf(a)),                      // direction
 		};
-		bgFb.transformXY(*rotozoom, [&] (sf::Uint8 l) { return palRZ[l]; });
-	};
+		renderRotozoom(bgFb.data(), ScrWidth, ScrHeight, s.rotozoom->_params, s.pal.rz.data());
+		bgFb.touch();
+	}
+};
 
-	// fire
-	tFxFunc fireFunc = [&] (tWin320x200::tBackBuffer& bgFb, int frame) {
+struct firefx
+{
+	static void prewarm(const fxassets&) {}
+	void operator()(fxstate& s, tBackBuffer& bgFb, int frame) const
+	{
 		if (frame == 0) {
-			fb16a->fill(0);
+			s.fb16a->fill(0);
 		}
-		setFire(ScrWidth, ScrHeight, fb16a->data(), frame);
-		bgFb.transformOfs(*fb16a, [&] (sf::Uint16 l) { return palFire[l >> 8]; });
-	};
+		setFire(ScrWidth, ScrHeight, s.fb16a->data(), frame, s.rnd);
+		s.fb16a->touch();
+		// rows above the flames keep color 0, only rows below the highest one are expanded
+		const sf::Uint16* d = s.fb16a->data();
+		int o = 0;
+		while (o < ScrWidth * ScrHeight && (d[o] >> 8) == 0)
+			++o;
+		const int top = o / ScrWidth;
+		const int y0 = frame == 0 ? 0 : std::min(top, s.fireTop);
+		s.fireTop = top;
+		demo::expandPal16(bgFb.data() + y0 * ScrWidth, d + y0 * ScrWidth, s.pal.fire.data(), (ScrHeight - y0) * ScrWidth);
+		bgFb.touch({ 0, y0, ScrWidth, ScrHeight });
+	}
+};
 
-	// circles
-	tFxFunc ccFunc = [&] (tWin320x200::tBackBuffer& bgFb, int frame) {
-		cc->_params = {
-			mito->data(),
+struct ccfx
+{
+	static void prewarm(const fxassets& a) { a.mito.prewarm(); }
+	void operator()(fxstate& s, tBackBuffer& bgFb, int frame) const
+	{
+		s.cc->_params = {
+			s.assets.mito.data(),
 			int(160 + 150 * sinf(0.03f * frame)), 100, // first pos
 			160, int(100 + 90 * sinf(0.04f * frame)),  // second pos
 		};
-		bgFb.transformXY(*cc, [&] (sf::Uint8 l) { return palCC[l]; });
-	};
+		renderCC(bgFb.data(), ScrWidth, ScrHeight, s.cc->_params, s.pal.cc.data());
+		bgFb.touch();
+	}
+};
 
+struct barsfx
+{
+	static void prewarm(const fxassets&) {}
+	void operator()(fxstate& s, tBackBuffer& bgFb, int frame) const
+	{
+		drawBars(s.fb8a->data(), ScrWidth, ScrHeight, frame);
+		s.fb8a->touch();
+		demo::expandPal8(bgFb.data(), s.fb8a->data(), s.pal.distort.data(), ScrWidth * ScrHeight);
+		bgFb.touch();
+	}
+};
 
-	// bars
-	tFxFunc barsFunc = [&] (tWin320x200::tBackBuffer& bgFb, int frame) {
-		drawBars(fb8a->data(), ScrWidth, ScrHeight, frame);
-		bgFb.transformOfs(*fb8a, [&] (sf::Uint8 l) { return palDistort[l]; });
-	};
+// plasma indices frozen at first frame, only the palette moves
+struct cyclefx
+{
+	static void prewarm(const fxassets& a) { a.pipo.prewarm(); }
+	void operator()(fxstate& s, tBackBuffer& bgFb, int frame) const
+	{
+		if (frame == 0) {
+			s.plasma->_params = {
+				s.assets.pipo.data(),
+				0,
+			};
+			s.cycleIdx->copyXY(*s.plasma);
+		}
+		const int t = frame % 512;
+		const tPalette pal = demo::rotatePal(demo::lerpPal(s.pal.plasma, s.pal.fire, t < 256 ? t : 511 - t, 255), frame / 2);
+		s.cyclePal.expand(bgFb, *s.cycleIdx, pal);
+	}
+};
 
-	// FX list
-	tFxFunc fxs[] = {
-		waterFunc,
-		bumpFunc,
-		plasmaFunc,
-		rzFunc,
-		ccFunc,
-		fireFunc,
-		barsFunc,
-	};
+typedef demo::fxlist<waterfx, bumpfx, plasmafx, rzfx, ccfx, firefx, barsfx, cyclefx> tFxList;
+
+// render one frame of a FX sequence, false once the sequence is over
+bool renderFrame(fxstate& s, const std::vector<int>& order, int fxDuration, tBackBuffer& bgFb, int frame)
+{
+	const int fxCount = int(order.size());
+	if (frame >= fxDuration * fxCount)
+		return false;
+	const int fxIdx = frame / fxDuration;
+	const int frameIdx = frame % fxDuration;
+	tFxList fxs;
+	if (frameIdx == 0) {
+		s.rnd.reset(s.seed + fxIdx);
+		// bake next FX images while this one runs
+		if (fxIdx + 1 < fxCount)
+			fxs.prewarm(order[fxIdx + 1], s.assets);
+	}
+	fxs.call(order[fxIdx], s, bgFb, frameIdx);
+	return true;
+}
+
+// ---------------------------------------------------------------------------------------
+// batch
+// ---------------------------------------------------------------------------------------
+
+// one independent clip
+struct fxjob
+{
+	fxpalettes pal;
+	std::vector<int> order;
+	sf::Uint32 seed;
+	int fxDuration;
+};
+
+// render every job on worker threads, sink gets begin(job), frame(job, frame, bgFb) and end(job)
+// calls from the thread rendering the job, returns the total frame count
+template <class S>
+int renderBatch(const fxassets& assets, const std::vector<fxjob>& jobs, int workers, S& sink)
+{
+	std::atomic<int> frames(0);
+	demo::runJobs(int(jobs.size()), workers, [&] (int j) {
+		const fxjob& job = jobs[j];
+		fxstate state(assets, job.pal, job.seed);
+		auto bgFb = new tBackBuffer();
+		sink.begin(j);
+		int frame = 0;
+		for (; renderFrame(state, job.order, job.fxDuration, *bgFb, frame); ++frame)
+			sink.frame(j, frame, *bgFb);
+		sink.end(j);
+		delete bgFb;
+		frames += frame;
+	});
+	return frames;
+}
+
+// streams raw RGBA frames to one file per job, or drops them without prefix.
+// A job whose file can't be opened or written stops writing and sets failed.
+struct filesink
+{
+	filesink(const char* p, int jobCount) : prefix(p), files(jobCount, nullptr), failed(false) {}
+	void begin(int job)
+	{
+		if (prefix == nullptr)
+			return;
+		char path[256] = {};
+		snprintf(path, 256, "%s%04d.rgba", prefix, job);
+		files[job] = fopen(path, "wb");
+		if (files[job] == nullptr)
+			error(job, "can't open");
+	}
+	void frame(int job, int, const tBackBuffer& bgFb)
+	{
+		if (files[job] == nullptr)
+			return;
+		if (fwrite(&bgFb.ofs(0), sizeof(sf::Uint32), ScrWidth * ScrHeight, files[job]) != size_t(ScrWidth * ScrHeight)) {
+			fclose(files[job]);
+			files[job] = nullptr;
+			error(job, "can't write");
+		}
+	}
+	void end(int job)
+	{
+		if (files[job] != nullptr && fclose(files[job]) != 0)
+			error(job, "can't write");
+		files[job] = nullptr;
+	}
+	void error(int job, const char* what)
+	{
+		fprintf(stderr, "%s %s%04d.rgba\n", what, prefix, job);
+		failed = true;
+	}
+
+	const char* prefix;
+	std::vector<FILE*> files;
+	std::atomic<bool> failed;
+};
+
+// ---------------------------------------------------------------------------------------
+// main
+// ---------------------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+	// checksum mode: "--record <file> [frames]" or "--check <file> [frames]"
+	const bool record = argc >= 3 && strcmp(argv[1], "--record") == 0;
+	const bool check = argc >= 3 && strcmp(argv[1], "--check") == 0;
+	const char* goldenPath = (record || check) ? argv[2] : nullptr;
+	const int goldenFrames = argc >= 4 ? atoi(argv[3]) : 64;
+	if (goldenPath != nullptr && goldenFrames < 1) {
+		fprintf(stderr, "frame count must be positive\n");
+		return 1;
+	}
+
+	// random numbers, reseeded at each FX start
+	const sf::Uint32 Seed = 0x2545f491u;
+
+	// images, always baked when checking frames so a stale cache can't hide a generator change
+	const fxassets assets(Seed, goldenPath != nullptr ? "" : demo::assetCachePrefix());
+
+	// batch mode: "--batch <jobs> [frames] [output prefix]"
+	if (argc >= 3 && strcmp(argv[1], "--batch") == 0) {
+		const int jobCount = atoi(argv[2]);
+		const int fxDuration = argc >= 4 ? atoi(argv[3]) : 64;
+		if (jobCount < 1 || fxDuration < 1) {
+			fprintf(stderr, "job and frame counts must be positive\n");
+			return 1;
+		}
+		std::vector<fxjob> jobs(jobCount);
+		for (int j = 0; j < jobCount; ++j) {
+			fxjob& job = jobs[j];
+			job.pal = makePalettes(j);
+			for (int i = 0; i < tFxList::COUNT; ++i)
+				job.order.push_back((i + j) % tFxList::COUNT);
+			job.seed = Seed + 977u * j;
+			job.fxDuration = fxDuration;
+		}
+		const int workers = std::max(1, int(std::thread::hardware_concurrency()));
+		filesink sink(argc >= 5 ? argv[4] : nullptr, jobCount);
+		const auto t0 = std::chrono::steady_clock::now();
+		const int frames = renderBatch(assets, jobs, workers, sink);
+		const std::chrono::duration<double> t = std::chrono::steady_clock::now() - t0;
+		const double fps = frames / std::max(t.count(), 1e-9);
+		printf("%d jobs, %d frames in %.2fs on %d cores (%s): %.1f frames/s, %.1f frames/s per core\n",
+			jobCount, frames, t.count(), workers, demo::isaName(demo::currentIsa()), fps, fps / workers);
+		return sink.failed ? 1 : 0;
+	}
+
+	fxstate state(assets, makePalettes(0), Seed, std::max(1, int(std::thread::hardware_concurrency())));
+	std::vector<int> order;
+	for (int i = 0; i < tFxList::COUNT; ++i)
+		order.push_back(i);
+	tFxList().prewarm(order[0], assets);
 
 	// run function
-	tWin320x200::tRunFunc runFunc = [&] (tWin320x200::tBackBuffer& bgFb, int frame, bool& screenShot) {
-		const int fxCount = sizeof(fxs) / sizeof(fxs[0]);
-		const int fxDuration = 1500;
-		if (frame >= fxDuration * fxCount)
+	const int fxDuration = goldenPath != nullptr ? goldenFrames : 1500;
+	auto runFunc = [&] (tBackBuffer& bgFb, int frame, bool& screenShot) {
+		if (!renderFrame(state, order, fxDuration, bgFb, frame))
 			return false;
-		const int fxIdx = frame / fxDuration;
-		const int frameIdx = frame % fxDuration;
-		if (frameIdx == fxDuration / 2)
+		if (frame % fxDuration == fxDuration / 2)
 			screenShot = true;
-		fxs[fxIdx](bgFb, frameIdx);
 		return true;
 	};
 
+	tWin320x200 win;
+
+	// render headless and compare frame hashes with golden file
+	if (goldenPath != nullptr) {
+		typedef demo::golden<ScrWidth, ScrHeight> tGolden;
+		tGolden gold(goldenFrames);
+		if (check && !gold.load(goldenPath)) {
+			fprintf(stderr, "can't load golden file %s\n", goldenPath);
+			return 1;
+		}
+		if (check && gold.fxFrames() != goldenFrames) {
+			fprintf(stderr, "golden file has %d frames per FX, not %d\n", gold.fxFrames(), goldenFrames);
+			return 1;
+		}
+		bool failed = false;
+		int frameCount = 0;
+		tGolden::tHash hash;
+		win.runHeadless([&] (tBackBuffer& bgFb, int frame, bool& screenShot) {
+			if (!runFunc(bgFb, frame, screenShot))
+				return false;
+			hash.compute(bgFb);
+			++frameCount;
+			if (record) {
+				gold.add(hash);
+				return true;
+			}
+			if (frame >= gold.size()) {
+				fprintf(stderr, "golden file ends at frame %d\n", gold.size());
+				failed = true;
+				return false;
+			}
+			int y, x;
+			if (hash.diff(gold.at(frame), y, x)) {
+				fprintf(stderr, "fx %d frame %d differs first at row %d, pixels %d-%d\n",
+					frame / goldenFrames, frame % goldenFrames, y, x, std::min(x + tGolden::tHash::SEGMENT, ScrWidth) - 1);
+				failed = true;
+				return false;
+			}
+			return true;
+		});
+		if (record && !gold.save(goldenPath)) {
+			fprintf(stderr, "can't save golden file %s\n", goldenPath);
+			return 1;
+		}
+		if (check && !failed && frameCount != gold.size()) {
+			fprintf(stderr, "rendered %d frames, golden file has %d\n", frameCount, gold.size());
+			failed = true;
+		}
+		return failed ? 1 : 0;
+	}
+
 	// run loop
 	win.run(runFunc);
 
 	return 0;
 }
-
@@ -2,24 +2,134 @@
 
 #include <cmath>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 
 #include <SFML/Graphics.hpp>
 #include <SFML/Window.hpp>
 #include <SFML/System.hpp>
 
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #define SYNC_60Hz 1
 
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DEMO_X86 1
+#else
+#define DEMO_X86 0
+#endif
+
+// kernel bodies are inlined into one wrapper per instruction set
+#if defined(__GNUC__) || defined(__clang__)
+#define DEMO_KERNEL_IMPL static inline __attribute__((always_inline))
+#else
+#define DEMO_KERNEL_IMPL static inline
+#endif
+
+// base is the compiler's default target, which may still be auto-vectorized (SSE2 on x86-64):
+// there is no portable per function switch to keep it scalar
+#define DEMO_ATTR_base
+#if DEMO_X86
+#define DEMO_ATTR_sse2 __attribute__((target("sse2")))
+#define DEMO_ATTR_avx2 __attribute__((target("avx2")))
+#define DEMO_ATTR_avx512 __attribute__((target("avx512f,avx512bw")))
+#else
+#define DEMO_ATTR_sse2
+#define DEMO_ATTR_avx2
+#define DEMO_ATTR_avx512
+#endif
+
+#define DEMO_KERNEL_VARIANT(name, set, impl, params, args) \
+	DEMO_ATTR_##set static void name##_##set params { impl args; }
+
+// defines name(params) running impl(args) compiled for the instruction set picked by demo::currentIsa()
+#define DEMO_KERNEL(name, impl, params, args) \
+	DEMO_KERNEL_VARIANT(name, base, impl, params, args) \
+	DEMO_KERNEL_VARIANT(name, sse2, impl, params, args) \
+	DEMO_KERNEL_VARIANT(name, avx2, impl, params, args) \
+	DEMO_KERNEL_VARIANT(name, avx512, impl, params, args) \
+	static inline void name params \
+	{ \
+		typedef void (*tKernel) params; \
+		static const tKernel kernels[] = { name##_base, name##_sse2, name##_avx2, name##_avx512 }; \
+		kernels[int(demo::currentIsa())] args; \
+	}
+
 namespace demo
 {
 
+enum class isa { base, sse2, avx2, avx512, count };
+
+inline const char* isaName(isa i)
+{
+	static const char* names[] = { "base", "sse2", "avx2", "avx512" };
+	return names[int(i)];
+}
+
+// best set supported by the cpu, OLDSCHOOLFX_ISA=base|sse2|avx2|avx512 forces another one
+inline isa detectIsa()
+{
+	isa best = isa::base;
+#if DEMO_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+		best = isa::sse2;
+	if (__builtin_cpu_supports("avx2"))
+		best = isa::avx2;
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		best = isa::avx512;
+#endif
+	const char* env = getenv("OLDSCHOOLFX_ISA");
+	if (env == nullptr)
+		return best;
+	for (int i = 0; i < int(isa::count); ++i)
+	{
+		if (strcmp(env, isaName(isa(i))) != 0)
+			continue;
+		if (i > int(best))
+		{
+			fprintf(stderr, "%s not supported, using %s\n", env, isaName(best));
+			return best;
+		}
+		return isa(i);
+	}
+	fprintf(stderr, "unknown instruction set %s, using %s\n", env, isaName(best));
+	return best;
+}
+
+inline isa currentIsa()
+{
+	static const isa i = detectIsa();
+	return i;
+}
+
 template <typename T, int W, int H>
 class frameb
 {
 public:
 	static constexpr int LENGTH = W * (H + 1);
-	template <typename... P>
-	void init(const std::function<T (int, int, P...)>& f, P... p)
+	template <typename F, typename... P>
+	void init(const F& f, P... p)
 	{
 		for (int y = 0, offset = 0; y < H; ++y)
 			for (int x = 0; x < W; ++x)
@@ -35,6 +145,7 @@ public:
 	const T& xy(int x, int y) const { return _data[y * W + x]; }
 	const T& ofs(int o) const { return _data[o]; }
 	T* data() { return _data; }
+	const T* data() const { return _data; }
 private:
 	T _data[LENGTH];
 };
@@ -56,6 +167,22 @@ public:
 	T ofs(int o) const { return F(W, H, o % W, o / W, _params); }
 };
 
+// [x0, x1) x [y0, y1)
+struct rect
+{
+	int x0, y0, x1, y1;
+
+	bool empty() const { return x0 >= x1 || y0 >= y1; }
+	rect merge(const rect& o) const
+	{
+		if (empty())
+			return o;
+		if (o.empty())
+			return *this;
+		return { std::min(x0, o.x0), std::min(y0, o.y0), std::max(x1, o.x1), std::max(y1, o.y1) };
+	}
+};
+
 template <typename T, int W, int H, class I>
 class buffer : public I
 {
@@ -65,12 +192,41 @@ public:
 	using I::xy;
 	using I::ofs;
 
+	// bumped each time the content changes, raw writes through data() must call touch()
+	unsigned generation() const { return _generation; }
+	void touch() { touch({ 0, 0, W, H }); }
+	void touch(const rect& r)
+	{
+		if (r.empty())
+			return;
+		++_generation;
+		_dirty = _dirty.merge(r);
+	}
+
+	// region changed since last clearDirty()
+	const rect& dirty() const { return _dirty; }
+	void clearDirty() { _dirty = { 0, 0, 0, 0 }; }
+
+	// storage writers, touched like every other write
+	template <typename F, typename... P>
+	void init(const F& f, P... p)
+	{
+		I::init(f, p...);
+		touch();
+	}
+	void fill(T v)
+	{
+		I::fill(v);
+		touch();
+	}
+
 	template <class U>
 	tBuffer& copyXY(const U& src)
 	{
 		for (int y = 0, o = 0; y < H; ++y)
 			for (int x = 0; x < W; ++x, ++o)
 				ofs(o) = src.xy(x, y);
+		touch();
 		return *this;
 	}
 
@@ -79,6 +235,7 @@ public:
 	{
 		for (int o = 0; o < W * H; ++o)
 			ofs(o) = src.ofs(o);
+		touch();
 		return *this;
 	}
 
@@ -88,6 +245,7 @@ public:
 		for (int y = 0, o = 0; y < H; ++y)
 			for (int x = 0; x < W; ++x, ++o)
 				ofs(o) = func(src0.xy(x, y));
+		touch();
 		return *this;
 	}
 
@@ -96,6 +254,7 @@ public:
 	{
 		for (int o = 0; o < W * H; ++o)
 			ofs(o) = func(src0.ofs(o));
+		touch();
 		return *this;
 	}
 
@@ -105,6 +264,7 @@ public:
 		for (int y = 0, o = 0; y < H; ++y)
 			for (int x = 0; x < W; ++x, ++o)
 				ofs(o) = func(src0.xy(x, y), src1.xy(x, y));
+		touch();
 		return *this;
 	}
 
@@ -113,8 +273,13 @@ public:
 	{
 		for (int o = 0; o < W * H; ++o)
 			ofs(o) = func(src0.ofs(o), src1.ofs(o));
+		touch();
 		return *this;
 	}
+
+private:
+	unsigned _generation = 0;
+	rect _dirty = { 0, 0, W, H };
 };
 
 template <int W, int H>
@@ -134,7 +299,9 @@ public:
 		return new buffer<T, W, H, demo::frameb<T, W, H>>();
 	}
 
-	void run(const tRunFunc& f)
+	// F is any callable with tRunFunc signature, a tRunFunc itself still works
+	template <typename F>
+	void run(const F& f)
 	{
 		auto bgFb = new tBackBuffer();
 
@@ -151,6 +318,7 @@ public:
 		sf::View view = win.getDefaultView();
 		sf::Vector2u winSize(W, H);
 
+		std::vector<sf::Uint32> upload;
 		int screenIdx = 0;
 		int frame = 0;
 		while (win.isOpen())
@@ -180,7 +348,21 @@ public:
 				break;
 			}
 
-			bg.update((sf::Uint8*)&bgFb->ofs(0));
+			// upload changed region only
+			const rect& d = bgFb->dirty();
+			if (d.empty()) {
+				// nothing changed
+			} else if (d.x0 == 0 && d.x1 == W) {
+				bg.update((sf::Uint8*)&bgFb->ofs(d.y0 * W), W, d.y1 - d.y0, 0, d.y0);
+			} else {
+				const int dw = d.x1 - d.x0;
+				upload.resize(dw * (d.y1 - d.y0));
+				for (int y = d.y0, o = 0; y < d.y1; ++y)
+					for (int x = d.x0; x < d.x1; ++x, ++o)
+						upload[o] = bgFb->xy(x, y);
+				bg.update((sf::Uint8*)upload.data(), dw, d.y1 - d.y0, d.x0, d.y0);
+			}
+			bgFb->clearDirty();
 
 			if (screenShot) {
 				char buffer[256] = {};
@@ -205,6 +387,137 @@ public:
 			++frame;
 		}
 	}
+
+	// same loop without window, no upload nor screenshots
+	template <typename F>
+	void runHeadless(const F& f)
+	{
+		auto bgFb = new tBackBuffer();
+		bool screenShot = false;
+		for (int frame = 0; f(*bgFb, frame, screenShot); ++frame)
+		{
+			bgFb->clearDirty();
+			screenShot = false;
+		}
+		delete bgFb;
+	}
+};
+
+// small xorshift generator, one per user so runs are reproducible
+class rng
+{
+public:
+	explicit rng(sf::Uint32 seed = 1) { reset(seed); }
+	void reset(sf::Uint32 seed) { _state = seed != 0 ? seed : 0x9e3779b9u; }
+	sf::Uint32 next()
+	{
+		_state ^= _state << 13;
+		_state ^= _state >> 17;
+		_state ^= _state << 5;
+		return _state;
+	}
+	// value in [0, n)
+	int operator()(int n) { return int(next() % sf::Uint32(n)); }
+private:
+	sf::Uint32 _state;
+};
+
+// FNV-1a hashes of a frame, each row is also hashed in SEGMENT pixel spans to locate differences
+template <int W, int H>
+struct framehash
+{
+	static constexpr int SEGMENT = 32;
+	static constexpr int SEGMENTS = (W + SEGMENT - 1) / SEGMENT;
+
+	sf::Uint64 frame;
+	sf::Uint32 segments[H][SEGMENTS];
+
+	template <class B>
+	void compute(const B& b)
+	{
+		frame = 0xcbf29ce484222325ull;
+		for (int y = 0, o = 0; y < H; ++y)
+		{
+			for (int s = 0; s < SEGMENTS; ++s)
+				segments[y][s] = 0x811c9dc5u;
+			for (int x = 0; x < W; ++x, ++o)
+			{
+				const sf::Uint32 v = b.ofs(o);
+				frame = (frame ^ v) * 0x100000001b3ull;
+				segments[y][x / SEGMENT] = (segments[y][x / SEGMENT] ^ v) * 0x01000193u;
+			}
+		}
+	}
+
+	// false if identical, else the first differing row and the first column of its first differing span
+	bool diff(const framehash& o, int& y, int& x) const
+	{
+		if (frame == o.frame)
+			return false;
+		for (y = 0; y < H; ++y)
+			for (int s = 0; s < SEGMENTS; ++s)
+				if (segments[y][s] != o.segments[y][s]) {
+					x = s * SEGMENT;
+					return true;
+				}
+		y = 0;
+		x = 0;
+		return true;
+	}
+};
+
+// list of frame hashes stored as a binary file, with the frame count of each FX
+template <int W, int H>
+class golden
+{
+public:
+	typedef framehash<W, H> tHash;
+
+	explicit golden(int fxFrames = 0) : _fxFrames(fxFrames) {}
+
+	void add(const tHash& h) { _hashes.push_back(h); }
+	int size() const { return int(_hashes.size()); }
+	int fxFrames() const { return _fxFrames; }
+	const tHash& at(int i) const { return _hashes[i]; }
+
+	bool load(const char* path)
+	{
+		FILE* f = fopen(path, "rb");
+		if (f == nullptr)
+			return false;
+		int header[4] = {};
+		bool ok = fread(header, sizeof(header), 1, f) == 1 && header[0] == W && header[1] == H && header[2] > 0 && header[3] >= 0;
+		if (ok)
+		{
+			// count must match the file size, never trust it for the allocation alone
+			const long start = ftell(f);
+			ok = fseek(f, 0, SEEK_END) == 0 && ftell(f) - start == long(header[3]) * long(sizeof(tHash)) && fseek(f, start, SEEK_SET) == 0;
+		}
+		if (ok)
+		{
+			_fxFrames = header[2];
+			_hashes.resize(header[3]);
+			ok = _hashes.empty() || fread(_hashes.data(), sizeof(tHash), _hashes.size(), f) == _hashes.size();
+		}
+		fclose(f);
+		return ok;
+	}
+
+	bool save(const char* path) const
+	{
+		FILE* f = fopen(path, "wb");
+		if (f == nullptr)
+			return false;
+		const int header[4] = { W, H, _fxFrames, size() };
+		bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+		ok = ok && (_hashes.empty() || fwrite(_hashes.data(), sizeof(tHash), _hashes.size(), f) == _hashes.size());
+		fclose(f);
+		return ok;
+	}
+
+private:
+	int _fxFrames;
+	std::vector<tHash> _hashes;
 };
 
 inline sf::Uint32 abgr(sf::Uint8 a, sf::Uint8 b, sf::Uint8 g, sf::Uint8 r)
@@ -273,30 +586,496 @@ std::array<T, N> makeRampPal(const std::initializer_list<T>& l)
 	return r;
 }
 
-template <typename T, int W, int H, typename... P>
-buffer<T, W, H, frameb<T, W, H>>* makeBuffer(T f(int, int, P...), P... p)
+// per entry blend of two palettes
+template <class T, size_t N>
+std::array<T, N> lerpPal(const std::array<T, N>& a, const std::array<T, N>& b, int mul, int div)
+{
+	std::array<T, N> r;
+	for (size_t i = 0; i < N; ++i)
+		r[i] = blend(a[i], b[i], mul, div);
+	return r;
+}
+
+// palette cycling, entry i takes color i + shift
+template <class T, size_t N>
+std::array<T, N> rotatePal(const std::array<T, N>& a, int shift)
+{
+	// negative shifts rotate the other way
+	const size_t s = size_t((shift % int(N) + int(N)) % int(N));
+	std::array<T, N> r;
+	for (size_t i = 0; i < N; ++i)
+		r[i] = a[(i + s) % N];
+	return r;
+}
+
+DEMO_KERNEL_IMPL void expandPal8Impl(sf::Uint32* __restrict dst, const sf::Uint8* __restrict src, const sf::Uint32* __restrict pal, int count)
+{
+	for (int i = 0; i < count; ++i)
+		dst[i] = pal[src[i]];
+}
+
+DEMO_KERNEL(expandPal8, expandPal8Impl,
+	(sf::Uint32* dst, const sf::Uint8* src, const sf::Uint32* pal, int count), (dst, src, pal, count))
+
+// 16bpp indices use their high byte
+DEMO_KERNEL_IMPL void expandPal16Impl(sf::Uint32* __restrict dst, const sf::Uint16* __restrict src, const sf::Uint32* __restrict pal, int count)
+{
+	for (int i = 0; i < count; ++i)
+		dst[i] = pal[src[i] >> 8];
+}
+
+DEMO_KERNEL(expandPal16, expandPal16Impl,
+	(sf::Uint32* dst, const sf::Uint16* src, const sf::Uint32* pal, int count), (dst, src, pal, count))
+
+static inline void expandPal(sf::Uint32* dst, const sf::Uint8* src, const sf::Uint32* pal, int count) { expandPal8(dst, src, pal, count); }
+static inline void expandPal(sf::Uint32* dst, const sf::Uint16* src, const sf::Uint32* pal, int count) { expandPal16(dst, src, pal, count); }
+
+// expands an index buffer through a palette, skipped when indices, palette and destination are unchanged.
+// Sources must be frameb backed: procst buffers change with their params without bumping generation().
+template <typename T, size_t N>
+class palcache
+{
+public:
+	template <int W, int H, class ID, typename TS, class IS>
+	bool expand(buffer<T, W, H, ID>& dst, const buffer<TS, W, H, IS>& src, const std::array<T, N>& pal)
+	{
+		static_assert(std::is_same<IS, frameb<TS, W, H>>::value, "palcache sources must be frameb backed");
+		static_assert(std::is_same<ID, frameb<T, W, H>>::value, "palcache destinations must be frameb backed");
+		if (_valid && _src == &src && _dst == &dst && _srcGeneration == src.generation() && _dstGeneration == dst.generation() && _pal == pal)
+			return false;
+		expandPal(dst.data(), src.data(), pal.data(), W * H);
+		dst.touch();
+		_valid = true;
+		_src = &src;
+		_dst = &dst;
+		_srcGeneration = src.generation();
+		_dstGeneration = dst.generation();
+		_pal = pal;
+		return true;
+	}
+	void invalidate() { _valid = false; }
+private:
+	bool _valid = false;
+	const void* _src = nullptr;
+	const void* _dst = nullptr;
+	unsigned _srcGeneration = 0;
+	unsigned _dstGeneration = 0;
+	std::array<T, N> _pal;
+};
+
+// fills W x (H + 1) values
+template <typename T, int W, int H, typename F, typename... P>
+void fillBuffer(T* d, const F& f, P... p)
 {
-	auto r = new demo::buffer<T, W, H, demo::frameb<T, W, H>>();
 	int offset = 0;
 	for (int y = 0; y < H; ++y)
 		for (int x = 0; x < W; ++x)
-			r->data()[offset++] = f(x, y, p...);
+			d[offset++] = f(x, y, p...);
 	// duplicate last horizontal line
 	for (int x = 0; x < W; ++x)
-		r->data()[W * H + x] = r->data()[W * (H - 1) + x];
+		d[W * H + x] = d[W * (H - 1) + x];
+}
+
+template <typename T, int W, int H, typename F, typename... P>
+buffer<T, W, H, frameb<T, W, H>>* makeBuffer(const F& f, P... p)
+{
+	auto r = new demo::buffer<T, W, H, demo::frameb<T, W, H>>();
+	fillBuffer<T, W, H>(r->data(), f, p...);
 	return r;
 }
 
+// bumped when an asset generator changes so older cache files are rebaked
+constexpr sf::Uint32 AssetCacheVersion = 1;
+
+inline sf::Uint32 assetKey(std::initializer_list<sf::Uint32> params)
+{
+	sf::Uint32 h = 0x811c9dc5u;
+	for (sf::Uint32 p : params)
+		h = (h ^ p) * 0x01000193u;
+	return h;
+}
+
+// prefix of cache files, OLDSCHOOLFX_CACHE overrides it and an empty value disables the cache
+inline const char* assetCachePrefix()
+{
+	const char* env = getenv("OLDSCHOOLFX_CACHE");
+	return env != nullptr ? env : "oldschoolfx-";
+}
+
+// W x (H + 1) image baked on a background thread when first needed,
+// mapped from "<prefix><name>-<key>.cache" when a previous run already baked it.
+// An empty prefix always bakes.
+template <typename T, int W, int H>
+class asset
+{
+public:
+	static constexpr int LENGTH = W * (H + 1);
+	typedef std::function<void (T*)> tBake;
+
+	asset(const char* name, sf::Uint32 key, const tBake& bake, const char* prefix)
+	: _name(name), _key(key), _bake(bake), _prefix(prefix) {}
+	asset(const asset&) = delete;
+	asset& operator=(const asset&) = delete;
+	~asset()
+	{
+		if (_ready.valid())
+			_ready.wait();
+#if !defined(_WIN32)
+		if (_map != nullptr)
+			munmap(_map, FILESIZE);
+#endif
+	}
+
+	// starts baking if not started yet
+	void prewarm() const
+	{
+		std::call_once(_started, [this] {
+			_ready = std::async(std::launch::async, [this] { load(); }).share();
+		});
+	}
+
+	// waits for the image
+	const T* data() const
+	{
+		prewarm();
+		_ready.wait();
+		return _data;
+	}
+
+private:
+	struct header
+	{
+		char magic[8];
+		sf::Uint32 version, key, width, height, size, pad;
+	};
+	static constexpr size_t FILESIZE = sizeof(header) + LENGTH * sizeof(T);
+
+	header makeHeader() const
+	{
+		return { { 'O', 'S', 'F', 'X', 'A', 'S', 'T', 0 }, AssetCacheVersion, _key, W, H, sizeof(T), 0 };
+	}
+
+	bool valid(const header& h) const
+	{
+		return memcmp(&h, &_expected, sizeof(header)) == 0;
+	}
+
+	void load() const
+	{
+		_expected = makeHeader();
+		char path[256] = {};
+		bool cached = _prefix[0] != 0;
+		if (cached && snprintf(path, 256, "%s%s-%08x.cache", _prefix, _name, _key) >= 256)
+		{
+			fprintf(stderr, "asset cache path too long for %s, not cached\n", _name);
+			cached = false;
+		}
+		if (cached && map(path))
+			return;
+		_owned.resize(LENGTH);
+		_bake(_owned.data());
+		_data = _owned.data();
+		if (cached)
+			save(path);
+	}
+
+	bool map(const char* path) const
+	{
+#if defined(_WIN32)
+		FILE* f = fopen(path, "rb");
+		if (f == nullptr)
+			return false;
+		header h;
+		_owned.resize(LENGTH);
+		const bool ok = fread(&h, sizeof(h), 1, f) == 1 && valid(h) && fread(_owned.data(), sizeof(T), LENGTH, f) == size_t(LENGTH);
+		fclose(f);
+		if (ok)
+			_data = _owned.data();
+		return ok;
+#else
+		const int fd = open(path, O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		void* p = MAP_FAILED;
+		if (fstat(fd, &st) == 0 && size_t(st.st_size) == FILESIZE)
+			p = mmap(nullptr, FILESIZE, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd);
+		if (p == MAP_FAILED)
+			return false;
+		if (!valid(*static_cast<const header*>(p)))
+		{
+			munmap(p, FILESIZE);
+			return false;
+		}
+		_map = p;
+		_data = reinterpret_cast<const T*>(static_cast<const char*>(p) + sizeof(header));
+		return true;
+#endif
+	}
+
+	// written aside then renamed, so concurrent runs never map a partial file
+	void save(const char* path) const
+	{
+#if defined(_WIN32)
+		const int pid = _getpid();
+#else
+		const int pid = getpid();
+#endif
+		char tmp[280] = {};
+		if (snprintf(tmp, 280, "%s.%d.tmp", path, pid) >= 280)
+			return;
+		FILE* f = fopen(tmp, "wb");
+		if (f == nullptr)
+			return;
+		const header h = makeHeader();
+		const bool ok = fwrite(&h, sizeof(h), 1, f) == 1 && fwrite(_data, sizeof(T), LENGTH, f) == size_t(LENGTH);
+		fclose(f);
+		if (!ok || rename(tmp, path) != 0)
+			remove(tmp);
+	}
+
+	const char* _name;
+	sf::Uint32 _key;
+	tBake _bake;
+	const char* _prefix;
+	mutable std::once_flag _started;
+	mutable std::shared_future<void> _ready;
+	mutable header _expected;
+	mutable std::vector<T> _owned;
+	mutable const T* _data = nullptr;
+	mutable void* _map = nullptr;
+};
+
+// static list of FX callables, dispatched by index without type erasure
+template <typename... F>
+class fxlist
+{
+public:
+	static constexpr int COUNT = sizeof...(F);
+
+	fxlist() {}
+	fxlist(const F&... f) : _fxs(f...) {}
+
+	template <typename... A>
+	void call(int idx, A&&... a)
+	{
+		dispatch<0>(idx, std::forward<A>(a)...);
+	}
+
+	// each FX type has a static prewarm() starting to bake what it reads
+	template <typename... A>
+	void prewarm(int idx, A&&... a)
+	{
+		dispatchPrewarm<0>(idx, std::forward<A>(a)...);
+	}
+
+private:
+	template <int I, typename... A>
+	typename std::enable_if<(I < COUNT)>::type dispatch(int idx, A&&... a)
+	{
+		if (idx == I)
+			std::get<I>(_fxs)(std::forward<A>(a)...);
+		else
+			dispatch<I + 1>(idx, std::forward<A>(a)...);
+	}
+
+	template <int I, typename... A>
+	typename std::enable_if<(I >= COUNT)>::type dispatch(int, A&&...)
+	{
+	}
+
+	template <int I, typename... A>
+	typename std::enable_if<(I < COUNT)>::type dispatchPrewarm(int idx, A&&... a)
+	{
+		if (idx == I)
+			std::tuple_element<I, std::tuple<F...>>::type::prewarm(std::forward<A>(a)...);
+		else
+			dispatchPrewarm<I + 1>(idx, std::forward<A>(a)...);
+	}
+
+	template <int I, typename... A>
+	typename std::enable_if<(I >= COUNT)>::type dispatchPrewarm(int, A&&...)
+	{
+	}
+
+	std::tuple<F...> _fxs;
+};
+
+template <typename... F>
+fxlist<F...> makeFxList(const F&... f)
+{
+	return fxlist<F...>(f...);
+}
+
+// indices of pending jobs for one worker
+class jobqueue
+{
+public:
+	void push(int job)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_jobs.push_back(job);
+	}
+	// owner takes newest job
+	bool pop(int& job)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_jobs.empty())
+			return false;
+		job = _jobs.back();
+		_jobs.pop_back();
+		return true;
+	}
+	// other workers take oldest job
+	bool steal(int& job)
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		if (_jobs.empty())
+			return false;
+		job = _jobs.front();
+		_jobs.pop_front();
+		return true;
+	}
+private:
+	std::mutex _mutex;
+	std::deque<int> _jobs;
+};
+
+// calls f(job) for every job in [0, count) on worker threads, idle workers steal from others
+template <typename F>
+void runJobs(int count, int workers, const F& f)
+{
+	std::vector<jobqueue> queues(workers);
+	for (int j = 0; j < count; ++j)
+		queues[j % workers].push(j);
+	auto work = [&] (int w) {
+		int job;
+		for (;;)
+		{
+			bool found = queues[w].pop(job);
+			for (int i = 1; i < workers && !found; ++i)
+				found = queues[(w + i) % workers].steal(job);
+			if (!found)
+				return;
+			f(job);
+		}
+	};
+	std::vector<std::thread> threads;
+	for (int w = 1; w < workers; ++w)
+		threads.emplace_back(work, w);
+	work(0);
+	for (auto& t : threads)
+		t.join();
+}
+
+// threads kept alive between calls, for work split many times per frame
+class workerpool
+{
+public:
+	// workers counts the calling thread
+	explicit workerpool(int workers)
+	{
+		for (int w = 1; w < workers; ++w)
+			_threads.emplace_back([this] { loop(); });
+	}
+	workerpool(const workerpool&) = delete;
+	workerpool& operator=(const workerpool&) = delete;
+	~workerpool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stop = true;
+		}
+		_wake.notify_all();
+		for (auto& t : _threads)
+			t.join();
+	}
+
+	int size() const { return int(_threads.size()) + 1; }
+
+	// calls f(job) for every job in [0, count), the caller works too and returns when all jobs are done
+	template <typename F>
+	void run(int count, const F& f)
+	{
+		if (_threads.empty() || count < 2) {
+			for (int j = 0; j < count; ++j)
+				f(j);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_task = [&f] (int j) { f(j); };
+			_count = count;
+			_next = 0;
+			_busy = int(_threads.size());
+			++_generation;
+		}
+		_wake.notify_all();
+		work();
+		std::unique_lock<std::mutex> lock(_mutex);
+		_done.wait(lock, [this] { return _busy == 0; });
+		_task = nullptr;
+	}
+
+private:
+	void work()
+	{
+		for (int j = _next++; j < _count; j = _next++)
+			_task(j);
+	}
+
+	void loop()
+	{
+		unsigned seen = 0;
+		for (;;)
+		{
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_wake.wait(lock, [&] { return _stop || _generation != seen; });
+				if (_stop)
+					return;
+				seen = _generation;
+			}
+			work();
+			std::lock_guard<std::mutex> lock(_mutex);
+			if (--_busy == 0)
+				_done.notify_one();
+		}
+	}
+
+	std::vector<std::thread> _threads;
+	std::mutex _mutex;
+	std::condition_variable _wake;
+	std::condition_variable _done;
+	std::function<void(int)> _task;
+	std::atomic<int> _next { 0 };
+	int _count = 0;
+	int _busy = 0;
+	unsigned _generation = 0;
+	bool _stop = false;
+};
+
 sf::Uint8 r8(int v, int a, int b)
 {
 	return sf::Uint8((255u * (v - a)) / (b - a));
 }
 
-inline sf::Uint8 sample(sf::Uint8* d, int x, int y)
+// offset of (x, y) in a wrapped 256 x 256 texture
+inline int sampleIndex(int x, int y)
 {
-	return d[((x & 255) << 8) | (y & 255)];
+	return ((x & 255) << 8) | (y & 255);
 }
 
+inline sf::Uint8 sample(const sf::Uint8* d, int x, int y)
+{
+	return d[sampleIndex(x, y)];
+}
+
+// pixels per pass of kernels computing texture offsets first then fetching them,
+// the offset pass vectorizes while texture and palette fetches stay scalar
+constexpr int SampleChunk = 64;
+
 template <typename T>
 inline T slerpi(T x, T b)
 {